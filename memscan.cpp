@@ -1,350 +1,63 @@
 #include <iostream>
-#include <stdio.h>
-#include <vector>
-#include <windows.h>
 #include <fstream>
+#include <sstream>
+#include <string.h>
+#include <io.h>
+#include <fcntl.h>
+#include "memscan.h"
 
 using namespace std;
 
-#define WRITABLE ( PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY )
-
-typedef enum {
-	COND_UNCONDITIONAL,
-	COND_EQUALS,
-	COND_INCREASED,
-	COND_DECREASED
-} Search_Condition;
-
-// Memory block data structure
-// -hproc: Handle of the process the memory block belongs to.
-// -addr: Base address of the memory block in the process's virtual address space.
-// -size: Size of the page region of pages with similar attributes.
-// -buffer: Buffer to hold the bytes of memory obtained for each memory block.
-// -searchmask: A boolean array to show which bytes in the buffer are to be ignored.
-// -matches: How many matches have been found that agree with the conditions placed.
-// -data_size: The size of the data type of concern. ex. 1 for unsigned char and 4 for int.
-// -next: Next memory block. Acts as a linked list.
-typedef class _Memblock {
-public:
-	HANDLE hProc;
-	unsigned char *addr;
-	int size;
-	vector<unsigned char> buffer;
-	vector<bool> searchmask;
-	unsigned int matches;
-	int data_size;
-	_Memblock *next;
-
-	// Initialize a memory block
-	_Memblock(HANDLE hProc, MEMORY_BASIC_INFORMATION *meminfo, int data_size) {
-		this->hProc = hProc;
-		this->addr = (unsigned char*) meminfo->BaseAddress;
-		this->size = meminfo->RegionSize;
-		vector<unsigned char> temp_buf(meminfo->RegionSize, 0);
-		this->buffer = temp_buf;
-		vector<bool> temp_mask(meminfo->RegionSize, 0);
-		for(unsigned int i = 0; i < temp_mask.size(); i += data_size) temp_mask[i] = 1;
-		this->searchmask = temp_mask;
-		this->matches = meminfo->RegionSize / data_size;
-		this->data_size = data_size;
-		this->next = NULL;
-	}
-
-	// Check whether the byte of interest is marked present in the search mask
-	bool is_in_search(SIZE_T offset) {
-		if(offset < ((SIZE_T) this->size)) {
-			return this->searchmask[offset];
-		} else {
-			return false;
-		}
-	}
-
-	// Update a memory block with which bytes the condition specifies
-	void update(Search_Condition condition, unsigned int val) {
-		unsigned char temp_buf[128*1024];
-		vector<bool> temp_search(this->searchmask.size(), 0);
-		SIZE_T bytes_left;
-		SIZE_T total_read;
-		SIZE_T bytes_to_read;
-		SIZE_T bytes_read;
-
-		// Only check if there are at least some matches possible
-		if(this->matches > 0) {
-			bytes_left = this->size;
-			total_read = 0;
-			this->matches = 0;
-
-			// Keep reading process memory while there are still bytes left to read
-			while(bytes_left > 0) {
-				bytes_to_read = (bytes_left < sizeof(temp_buf)) ? bytes_left : sizeof(temp_buf);
-				if(ReadProcessMemory(this->hProc, this->addr + total_read, temp_buf, bytes_to_read, &bytes_read)) {
-					if(bytes_read != bytes_to_read) {
-						break;
-					}
-
-					// Iterate through the buffer, incrementing by the data size (unsigned char(1)/short(2)/int(4))
-					for(SIZE_T offset = 0; offset < bytes_read; offset += this->data_size) {
-						if(this->searchmask[total_read+offset]) {
-							bool is_match = false;
-							unsigned int temp_val;
-							unsigned int prev_val = 0;
-
-							// Read the value from the buffer depending on data size
-							switch(this->data_size) {
-								case 1:
-									temp_val = *((unsigned char*) &temp_buf[offset]);
-									prev_val = *((unsigned char*) &buffer[total_read+offset]);
-									break;
-								case 2:
-									temp_val = *((unsigned short*) &temp_buf[offset]);
-									prev_val = *((unsigned short*) &buffer[total_read+offset]);
-									break;
-								case 4:
-								default:
-									temp_val = *((unsigned int*) &temp_buf[offset]);
-									prev_val = *((unsigned int*) &buffer[total_read+offset]);
-									break;
-							}
-
-							// Update matches in the buffer based on condition
-							switch(condition) {
-								case COND_EQUALS:
-									is_match = (temp_val == val);
-									break;
-								case COND_INCREASED:
-									is_match = (prev_val < temp_val);
-									break;
-								case COND_DECREASED:
-									is_match = (prev_val > temp_val);
-									break;
-								default:
-									break;
-							}
-
-							if(is_match) {
-								this->matches++;
-								temp_search[total_read+offset] = 1;
-							}
-						}
-					}
-
-					// Copy the temp buf into the actual buffer and update reading data
-					for(unsigned int i = 0; i < bytes_read; i++) {
-						this->buffer[total_read + i] = temp_buf[i];
-					}
-					bytes_left -= bytes_read;
-					total_read += bytes_read;
-				} else {
-					break;
-				}
-			}
-		}
-		// Update searchmask with newly made searchmask based off of currently seen  matches
-		this->searchmask = temp_search;
-	}
-
-	~_Memblock() {}
-
-} Memblock;
-
-// Linked list of memory blocks
-typedef class _Scan {
-public:
-	Memblock *head;
-
-	_Scan() {
-		head = NULL;
-	}
-
-	// Initialize the linked list with memory blocks of the specified process
-	_Scan(unsigned int pid, int data_size) {
-		head = NULL;
-		MEMORY_BASIC_INFORMATION meminfo;
-		unsigned char *addr = 0;
-		
-		// Gets the handle of the process with a request for all access
-		HANDLE hProc = OpenProcess(PROCESS_ALL_ACCESS, false, pid);
-
-		if(hProc) {
-			SYSTEM_INFO si;
-			GetSystemInfo(&si);
-			while(addr < si.lpMaximumApplicationAddress) {
-				// Retrievs the BASIC_MEMORY_INFORMATION object of the process of interest
-				if(VirtualQueryEx(hProc, addr, &meminfo, sizeof(meminfo)) == 0) {
-					break;
-				}
-				// Check for flags to ensure it isn't empty reserved memory and it has write permissions
-				if((meminfo.State & MEM_COMMIT) && (meminfo.Protect & WRITABLE)) {
-					Memblock *mb = new Memblock(hProc, &meminfo, data_size);
-					if(mb) {
-						mb->next = head;
-						head = mb;
-					}
-				}
-				addr = (unsigned char*) meminfo.BaseAddress + meminfo.RegionSize;
-			}
-		} else {
-			cout << "PID is not available or valid" << endl;
-			head = NULL;
-		}
-	}
-
-	// Update the linked list with new conditions
-	void update(Search_Condition condition, unsigned int val) {
-		Memblock *temp_head = this->head;
-		while(temp_head) {
-			// If the condition is unconditional, the searhmask is updated with a match for each piece of data in the buffer
-			if(condition == COND_UNCONDITIONAL) {
-				for(unsigned int i = 0; i < temp_head->searchmask.size(); i += temp_head->data_size) {
-					temp_head->searchmask[i] = 1;
-					temp_head->matches = temp_head->searchmask.size() / temp_head->data_size;
-				}
-				temp_head = temp_head->next;
-			} else {
-				temp_head->update(condition, val);
-				temp_head = temp_head->next;
-			}
-		}
-	}
-
-	// Write a value to a specified address in a process's memory
-	void poke(HANDLE hProc, unsigned char *addr, int data_size, unsigned int val) {
-		if(WriteProcessMemory(hProc, addr, &val, data_size, NULL) == 0) {
-			cout << "Failed to poke" << endl;
-		}
-	}
+// Synthetic target used by the benchmark
+#define BENCH_BLOCKS 64
+#define BENCH_BLOCK_SIZE ( 1024*1024 )
+#define BENCH_PASSES 5
 
-	// Reads the value from a specified address in a process's memory
-	unsigned int peek(HANDLE hProc, unsigned char *addr, int data_size) {
-		unsigned int val = 0;
-		if(ReadProcessMemory(hProc, addr, &val, data_size, NULL) == 0) {
-			cout << "Failed to peek" << endl;
-		}
-		return val;
-	}
-
-	// Print the info about the memory blocks in the list
-	void scan_dump() {
-		Memblock *temp_head = this->head;
-		while(temp_head) {
-			printf("0x%08x %d\r\n", temp_head->addr, temp_head->size);
-			/*
-			for(int i = 0; i < temp_head->size; i++) {
-				printf("%02x", temp_head->buffer[i]);
-			}
-			*/
-			temp_head = temp_head->next;
-		}
-	}
-
-	// Print the addresses of every match
-	void print_matches() {
-		Memblock *temp_head = this->head;
-		int list_number = 0;
-		while(temp_head) {
-			for(unsigned int offset = 0; offset < temp_head->size; offset += temp_head->data_size) {
-				if(temp_head->is_in_search(offset)) {
-					unsigned int val = peek(temp_head->hProc, temp_head->addr + offset, temp_head->data_size);
-					printf("%d: Address - 0x%08x: Value - (Hex) 0x%08x, (Dec) %d\r\n", list_number++, temp_head->addr + offset, val, val);
-				}
-			}
-			temp_head = temp_head->next;
-		}
-	}
-
-	// Get matches through counting search mask values
-	unsigned int get_matches() {
-		Memblock *temp_head = this->head;
-		unsigned int count = 0;
-		while(temp_head) {
-			for(unsigned int offset = 0; offset < temp_head->size; offset += temp_head->data_size) {
-				if(temp_head->is_in_search(offset)) {
-					count++;
-				}
-			}
-			temp_head = temp_head->next;
-		}
-		return count;
-	}
-
-	// Get matches through summing the match counts
-	unsigned int get_matches2() {
-		Memblock *temp_head = this->head;
-		unsigned int count = 0;
-		while(temp_head) {
-			count += temp_head->matches;
-			temp_head = temp_head->next;
-		}
-		return count;
-	}
+// Retrieve the local list of processes
+void view_tasklist(Process_Catalog &catalog) {
+	catalog.refresh();
+	catalog.print();
+}
 
-	// Get first match's address
-	unsigned char* get_match() {
-		Memblock *temp_head = this->head;
-		unsigned int count = 0;
-		while(temp_head) {
-			for(unsigned int offset = 0; offset < temp_head->size; offset += temp_head->data_size) {
-				if(temp_head->is_in_search(offset)) {
-					return temp_head->addr + offset;
-				}
-			}
-			temp_head = temp_head->next;
-		}
-		return NULL;
+// Retrieve the pid of interest from the user, either directly or by name
+unsigned int get_pid(Process_Catalog &catalog, string &name) {
+	cout << "Enter the process you were interested in (Enter pid, name or regex):" << endl;
+	string choice_string;
+	cin >> choice_string;
+	catalog.refresh();
+	if(choice_string.find_first_not_of("0123456789") == string::npos) {
+		int choice = atoi(choice_string.c_str());
+		const Process_Entry *entry = catalog.find((DWORD) choice);
+		name = entry ? entry->name : "";
+		return (unsigned int) choice;
 	}
-
-	// Get the size of the linked list in bytes
-	unsigned int get_size() {
-		Memblock *temp_head = this->head;
-		unsigned int size = 0;
-		while(temp_head) {
-			size += temp_head->size;
-			temp_head = temp_head->next;
-		}
-		return size;
+	const Process_Entry *entry = catalog.find(choice_string);
+	if(!entry) {
+		cout << "No process matches " << choice_string << endl;
+		name = "";
+		return 0;
 	}
+	cout << "Found " << entry->name << " with PID " << entry->pid << endl;
+	name = entry->name;
+	return entry->pid;
+}
 
-	// Get how many nodes are in the linked list
-	int get_blocks() {
-		Memblock *temp_head = this->head;
-		int count = 0;
-		while(temp_head) {
-			count++;
-			temp_head = temp_head->next;
-		}
-		return count;
+// Re-attach to the target by name if it has exited and a process with the same name is running again
+void check_target(Scan *current_scan, Process_Catalog &catalog, unsigned int &pid, const string &name) {
+	if(name.empty() || current_scan->get_blocks() == 0 || current_scan->is_alive()) {
+		return;
 	}
-
-	// Free up the memory used to create memblocks when done and close the handle to the process
-	~_Scan() {
-		if(head) {
-			CloseHandle(head->hProc);
-		}
-		while(head) {
-			Memblock *temp_head = head;
-			head = head->next;
-			delete temp_head;
-		}
+	// Only the exact name counts here. A regex would latch onto whatever else happens to match it.
+	catalog.refresh();
+	const Process_Entry *entry = catalog.find_by_name(name);
+	if(entry && current_scan->open(entry->pid, current_scan->get_data_size())) {
+		pid = entry->pid;
+		cout << name << " restarted with PID " << pid << ". Re-attached and reset all matches." << endl;
 	}
-
-} Scan;
-
-// Retrieve the local list of processes
-void view_tasklist() {
-	system("tasklist | awk '{printf \"%-30s %-15s \\n \", $1, $2}'");
 }
 
-// Retrieve the pid of interest from the user
-unsigned int get_pid() {
-	cout << "Enter the process you were interested in (Enter pid):" << endl;
-	string choice_string;
-	cin >> choice_string;
-	int choice = atoi(choice_string.c_str());
-	return (unsigned int) choice;
-}
-
-// Create a new scan and segment it by specific data type
-Scan* create_scan(Scan *current_scan, unsigned int &pid) {
+// Point the scan at a new process and segment it by specific data type
+Scan* create_scan(Scan *current_scan, unsigned int &pid, string &name, Process_Catalog &catalog) {
 	while(1) {
 		cout << endl << "===================================" << endl
 			<< "How do you want to segment the scan (Enter number)?" << endl
@@ -354,58 +67,34 @@ Scan* create_scan(Scan *current_scan, unsigned int &pid) {
 			<< "4. Go back" << endl;
 		int choice_1;
 		cin >> choice_1;
-		unsigned int new_pid;
+		int data_size;
 		switch(choice_1) {
 			case 1:
-				new_pid = get_pid();
-				{
-					Scan *new_scan_1 = new Scan(new_pid, 1); 
-					if(new_scan_1->head) {
-						if(current_scan) {
-							delete current_scan;
-						}
-						pid = new_pid;
-						return new_scan_1;
-					} else {
-						cout << "Scan was invalid" << endl;
-					}
-				}
+				data_size = 1;
 				break;
 			case 2:
-				new_pid = get_pid();
-				{
-					Scan *new_scan_2 = new Scan(new_pid, 2); 
-					if(new_scan_2->head) {
-						if(current_scan) {
-							delete current_scan;
-						}
-						pid = new_pid;
-						return new_scan_2;
-					} else {
-						cout << "Scan was invalid" << endl;
-					}
-				}
+				data_size = 2;
 				break;
 			case 3:
-				new_pid = get_pid();
-				{
-					Scan *new_scan_3 = new Scan(new_pid, 4); 
-					if(new_scan_3->head) {
-						if(current_scan) {
-							delete current_scan;
-						}
-						pid = new_pid;
-						return new_scan_3;
-					} else {
-						cout << "Scan was invalid" << endl;
-					}
-				}
+				data_size = 4;
 				break;
 			case 4:
 				return current_scan;
 			default:
 				cout << "Invalid choice. Try again." << endl;
-				break;
+				continue;
+		}
+		string new_name;
+		unsigned int new_pid = get_pid(catalog, new_name);
+		if(new_pid && current_scan->open(new_pid, data_size)) {
+			pid = new_pid;
+			name = new_name;
+			if(current_scan->get_dropped()) {
+				cout << current_scan->get_dropped() << " regions were left out of the scan, out of memory" << endl;
+			}
+			return current_scan;
+		} else {
+			cout << "Scan was invalid" << endl;
 		}
 	}
 }
@@ -417,71 +106,371 @@ void equal_filter(Scan *current_scan) {
 	cin >> val;
 	cout << "Filtering for " << val << endl;
 	current_scan->update(COND_EQUALS, val);
-	cout << "Current matches: " << current_scan->get_matches() << endl;
+	cout << "Current matches: " << current_scan->get_matches2() << endl;
 }
 
 // Filter for increased value
 void inc_filter(Scan *current_scan) {
 	cout << "Filtering for an increased value" << endl;
 	current_scan->update(COND_INCREASED, 0);
-	cout << "Current matches: " << current_scan->get_matches() << endl;
+	cout << "Current matches: " << current_scan->get_matches2() << endl;
 }
 
 // Filter for decreased value
 void dec_filter(Scan *current_scan) {
 	cout << "Filtering for a decreased value" << endl;
 	current_scan->update(COND_DECREASED, 0);
-	cout << "Current matches: " << current_scan->get_matches() << endl;
+	cout << "Current matches: " << current_scan->get_matches2() << endl;
+}
+
+// Filter for a group of values at fixed offsets from each other
+void group_filter(Scan *current_scan) {
+	cout << "Describe the group (ex. u32 100 at +0, f32 1.5 at +8, u16 any at +12 within 64 bytes):" << endl;
+	string text;
+	cin >> ws;
+	getline(cin, text);
+	Group group;
+	if(!parse_group(text, group)) {
+		cout << "Invalid group. Try again." << endl;
+		return;
+	}
+	cout << "Filtering for the group" << endl;
+	current_scan->update(COND_GROUP, 0, &group);
+	cout << "Current matches: " << current_scan->get_matches2() << endl;
 }
 
 // Resets all matches
 void uncond_filter(Scan *current_scan) {
 	cout << "Resetting all conditions" << endl;
 	current_scan->update(COND_UNCONDITIONAL, 0);
-	cout << "Current matches: " << current_scan->get_matches() << endl;
+	cout << "Current matches: " << current_scan->get_matches2() << endl;
+}
+
+// Print every match with its current value
+void show_matches(Scan *current_scan) {
+	unsigned int failed = current_scan->print_matches();
+	if(failed) {
+		cout << failed << " values could not be read" << endl;
+	}
 }
 
 // Overwrites a value at a specified address
 void overwrite(Scan *current_scan) {
-	unsigned int current_matches = current_scan->get_matches();
+	unsigned int current_matches = current_scan->get_matches2();
 	unsigned int match_wanted = 0;
 	unsigned int val = 0;
 	while(1) {
 		cout << "Current list of matches and their values:" << endl;
-		current_scan->print_matches();
+		show_matches(current_scan);
 		cout << endl;
 		cout << "Enter list position of the value you want to overwrite:" << endl;
 		cin >> match_wanted;
 		if(match_wanted >= current_matches) {
 			cout << "Invalid input. Try again." << endl;
 		} else {
-			Memblock *temp_head = current_scan->head;
-			unsigned int list_number = 0;
-			while(temp_head) {
-				for(unsigned int offset = 0; offset < temp_head->size; offset += temp_head->data_size) {
-					if(temp_head->is_in_search(offset) && list_number < match_wanted) {
-						list_number++;
-					} else if(temp_head->is_in_search(offset) && list_number == match_wanted) {
-						unsigned int current_val = current_scan->peek(temp_head->hProc, temp_head->addr + offset, temp_head->data_size);
-						cout << "Current value is: " << current_val << endl;
-						cout << "Enter value to overwrite with:" << endl;
-						cin >> val;
-
-						current_scan->poke(temp_head->hProc, temp_head->addr + offset, temp_head->data_size, val);
-						cout << "Value has been overwritten." << endl;
-						return;
+			unsigned char *addr = current_scan->get_match(match_wanted);
+			unsigned int current_val;
+			if(!current_scan->peek(addr, current_val)) {
+				cout << "Failed to peek" << endl;
+				return;
+			}
+			cout << "Current value is: " << current_val << endl;
+			cout << "Enter value to overwrite with:" << endl;
+			cin >> val;
+
+			if(current_scan->poke(addr, val)) {
+				cout << "Value has been overwritten." << endl;
+			} else {
+				cout << "Failed to poke" << endl;
+			}
+			return;
+		}
+	}
+}
+
+// Time each read engine on a synthetic target in this process so the fastest can be picked for the host
+int run_benchmark() {
+	SIZE_T target_size = BENCH_BLOCKS * BENCH_BLOCK_SIZE;
+	unsigned char *target = (unsigned char*) VirtualAlloc(NULL, target_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	HANDLE hProc = OpenProcess(PROCESS_ALL_ACCESS, false, GetCurrentProcessId());
+	if(!target || !hProc) {
+		cout << "Could not set up the benchmark target" << endl;
+		if(hProc) {
+			CloseHandle(hProc);
+		}
+		if(target) {
+			VirtualFree(target, 0, MEM_RELEASE);
+		}
+		return 1;
+	}
+	for(SIZE_T i = 0; i < target_size; i += sizeof(unsigned int)) {
+		*((unsigned int*) &target[i]) = (unsigned int) (i / sizeof(unsigned int) * 2654435761u) % 1000;
+	}
+
+	// Build a scan over the target as if it were a process with BENCH_BLOCKS regions
+	vector<MEMORY_BASIC_INFORMATION> found;
+	for(unsigned int i = 0; i < BENCH_BLOCKS; i++) {
+		MEMORY_BASIC_INFORMATION meminfo;
+		meminfo.BaseAddress = target + i * BENCH_BLOCK_SIZE;
+		meminfo.RegionSize = BENCH_BLOCK_SIZE;
+		found.push_back(meminfo);
+	}
+	Scan bench_scan;
+	if(!bench_scan.open(hProc, found, 4)) {
+		cout << "Could not set up the benchmark target" << endl;
+		CloseHandle(hProc);
+		VirtualFree(target, 0, MEM_RELEASE);
+		return 1;
+	}
+
+	const char *names[] = { "sync", "pipeline", "queued" };
+	Read_Engine engines[] = { ENGINE_SYNC, ENGINE_PIPELINE, ENGINE_QUEUED };
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	printf("Scanning %d blocks of %d KiB, best of %d passes\r\n", BENCH_BLOCKS, BENCH_BLOCK_SIZE / 1024, BENCH_PASSES);
+	// A pass faster than the timer can tell is counted as one tick, so the rates stay finite
+	double tick = 1.0 / freq.QuadPart;
+	printf("%-10s %10s %10s %12s %12s\r\n", "engine", "read ms", "update ms", "read MB/s", "update MB/s");
+	for(unsigned int e = 0; e < 3; e++) {
+		double best_read = 0;
+		double best_update = 0;
+		bench_scan.set_engine(engines[e]);
+		for(unsigned int pass = 0; pass < BENCH_PASSES; pass++) {
+			LARGE_INTEGER start, middle, end;
+			bench_scan.update(COND_UNCONDITIONAL, 0);
+			QueryPerformanceCounter(&start);
+			bench_scan.read_regions();
+			QueryPerformanceCounter(&middle);
+			bench_scan.update(COND_EQUALS, 7);
+			QueryPerformanceCounter(&end);
+			double read_seconds = (double) (middle.QuadPart - start.QuadPart) / freq.QuadPart;
+			double update_seconds = (double) (end.QuadPart - middle.QuadPart) / freq.QuadPart;
+			if(pass == 0 || read_seconds < best_read) {
+				best_read = read_seconds;
+			}
+			if(pass == 0 || update_seconds < best_update) {
+				best_update = update_seconds;
+			}
+		}
+		best_read = (best_read > tick) ? best_read : tick;
+		best_update = (best_update > tick) ? best_update : tick;
+		printf("%-10s %10.2f %10.2f %12.1f %12.1f %u matches\r\n", names[e], best_read * 1000, best_update * 1000,
+			target_size / best_read / (1024*1024), target_size / best_update / (1024*1024), bench_scan.get_matches2());
+	}
+	VirtualFree(target, 0, MEM_RELEASE);
+	return 0;
+}
+
+// Look up a read engine by name
+bool parse_engine(const string &name, Read_Engine &engine) {
+	if(name == "sync") {
+		engine = ENGINE_SYNC;
+	} else if(name == "pipeline") {
+		engine = ENGINE_PIPELINE;
+	} else if(name == "queued") {
+		engine = ENGINE_QUEUED;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Run a script of scan commands without the menu, one command per line. Lines starting with # are skipped.
+//	attach <pid|name|regex> [1|2|4]	Scan a process, segmented by data size (4 by default)
+//	engine sync|pipeline|queued	Choose the read engine
+//	equal <value>, increased, decreased, reset, group <group>	Filter the matches
+//	count	Report the number of matches
+//	format text|csv|jsonl|binary	Choose how results are written
+//	output <path>|-	Write results to a file or back to stdout
+//	limit <n>	Write at most n matches per list (0 for no cap)
+//	list [first] [count]	Write a page of matches with their values from the last filter, or their current values
+//		if no filter has run since the last attach or reset
+//	peek <address>, poke <address> <value>	Read or write a value at an address
+// Results go to the output. Match counts and errors go to stderr.
+int run_batch(const char *script_path, Read_Engine engine, bool large_pages) {
+	ifstream script(script_path);
+	if(!script) {
+		cerr << "Could not open " << script_path << endl;
+		return 1;
+	}
+
+	// Put stdout in binary mode so results reach it byte for byte, the same as a file opened with "wb"
+	_setmode(_fileno(stdout), _O_BINARY);
+
+	Scan scan;
+	scan.set_engine(engine);
+	if(large_pages && !scan.use_large_pages(true)) {
+		cerr << "Large pages are not available, using normal pages" << endl;
+	}
+	Process_Catalog catalog;
+	Output_Format format = OUTPUT_TEXT;
+	FILE *out = stdout;
+	unsigned int limit = 0;
+	bool attached = false;
+
+	string line;
+	for(unsigned int line_number = 1; getline(script, line); line_number++) {
+		istringstream tokens(line);
+		string command;
+		if(!(tokens >> command) || command[0] == '#') {
+			continue;
+		}
+		if(!attached && command != "attach" && command != "engine" && command != "format"
+			&& command != "output" && command != "limit") {
+			cerr << "line " << line_number << ": no process attached" << endl;
+			return 1;
+		}
+
+		bool ok = true;
+		if(command == "attach") {
+			string target;
+			int data_size;
+			ok = !(tokens >> target).fail();
+			if((tokens >> data_size).fail()) {
+				data_size = 4;
+			}
+			ok = ok && (data_size == 1 || data_size == 2 || data_size == 4);
+			if(ok) {
+				catalog.refresh();
+				const Process_Entry *entry = NULL;
+				if(target.find_first_not_of("0123456789") == string::npos) {
+					entry = catalog.find((DWORD) atoi(target.c_str()));
+				} else {
+					entry = catalog.find(target);
+				}
+				attached = entry && scan.open(entry->pid, data_size);
+				ok = attached;
+				if(attached) {
+					cerr << "Attached to " << entry->name << " (" << entry->pid << "), "
+						<< scan.get_blocks() << " regions, " << scan.get_size() << " bytes" << endl;
+					if(scan.get_dropped()) {
+						cerr << "line " << line_number << ": " << scan.get_dropped()
+							<< " regions were left out of the scan, out of memory" << endl;
+					}
+				}
+			}
+		} else if(command == "engine") {
+			string name;
+			Read_Engine new_engine;
+			ok = (tokens >> name) && parse_engine(name, new_engine);
+			if(ok) {
+				scan.set_engine(new_engine);
+			}
+		} else if(command == "equal") {
+			unsigned int val;
+			ok = !(tokens >> val).fail();
+			if(ok) {
+				scan.update(COND_EQUALS, val);
+			}
+		} else if(command == "increased") {
+			scan.update(COND_INCREASED, 0);
+		} else if(command == "decreased") {
+			scan.update(COND_DECREASED, 0);
+		} else if(command == "reset") {
+			scan.update(COND_UNCONDITIONAL, 0);
+		} else if(command == "group") {
+			string text;
+			Group group;
+			getline(tokens, text);
+			ok = parse_group(text, group);
+			if(ok) {
+				scan.update(COND_GROUP, 0, &group);
+			}
+		} else if(command == "count") {
+			cerr << "Current matches: " << scan.get_matches2() << endl;
+		} else if(command == "format") {
+			string name;
+			tokens >> name;
+			if(name == "text") {
+				format = OUTPUT_TEXT;
+			} else if(name == "csv") {
+				format = OUTPUT_CSV;
+			} else if(name == "jsonl") {
+				format = OUTPUT_JSONL;
+			} else if(name == "binary") {
+				format = OUTPUT_BINARY;
+			} else {
+				ok = false;
+			}
+		} else if(command == "output") {
+			string path;
+			ok = !(tokens >> path).fail();
+			if(ok) {
+				FILE *new_out = (path == "-") ? stdout : fopen(path.c_str(), "wb");
+				ok = (new_out != NULL);
+				if(ok) {
+					if(out != stdout) {
+						fclose(out);
 					}
+					out = new_out;
 				}
-				temp_head = temp_head->next;
 			}
+		} else if(command == "limit") {
+			ok = !(tokens >> limit).fail();
+		} else if(command == "list") {
+			unsigned int first = 0;
+			unsigned int count;
+			tokens >> first;
+			if((tokens >> count).fail()) {
+				count = 0;
+			}
+			// A count of 0 means all matches, which the limit still caps
+			if(limit && (count == 0 || count > limit)) {
+				count = limit;
+			}
+			// Snapshots are only filled in by filters, so read the values live until one has run
+			unsigned int failed = 0;
+			Result_Writer writer(out, format);
+			scan.write_matches(writer, first, count, !scan.is_filtered(), &failed);
+			if(failed) {
+				cerr << "line " << line_number << ": " << failed << " values could not be read" << endl;
+			}
+		} else if(command == "peek" || command == "poke") {
+			string addr_string;
+			ok = !(tokens >> addr_string).fail();
+			unsigned char *addr = (unsigned char*) (SIZE_T) strtoull(addr_string.c_str(), NULL, 0);
+			if(ok && command == "poke") {
+				unsigned int val;
+				ok = !(tokens >> val).fail();
+				ok = ok && scan.poke(addr, val);
+			} else if(ok) {
+				unsigned int val;
+				ok = scan.peek(addr, val);
+				if(ok) {
+					Result_Writer writer(out, format);
+					writer.write_match(0, addr, val);
+				}
+			}
+		} else {
+			ok = false;
+		}
+
+		if(!ok) {
+			cerr << "line " << line_number << ": could not run '" << line << "'" << endl;
+			if(out != stdout) {
+				fclose(out);
+			}
+			return 1;
 		}
 	}
+	if(out != stdout) {
+		fclose(out);
+	}
+	return 0;
 }
 
-int ui_begin() {
-	Scan *current_scan = 0;
-	unsigned int current_pid;
+int ui_begin(Read_Engine engine, bool large_pages) {
+	// One scan is kept for the whole session so every new process reuses its memory
+	Scan *current_scan = new Scan();
+	current_scan->set_engine(engine);
+	if(large_pages && !current_scan->use_large_pages(true)) {
+		cout << "Large pages are not available, using normal pages" << endl;
+	}
+	Process_Catalog catalog;
+	unsigned int current_pid = 0;
+	string current_name;
 	while(1) {
+		check_target(current_scan, catalog, current_pid, current_name);
 		cout << endl << "===================================" << endl
 			<< "Memory Scan Menu (Enter number): " << endl
 			<< "1. View processes" << endl
@@ -492,38 +481,43 @@ int ui_begin() {
 			<< "6. Look at all current matches" << endl
 			<< "7. Reset to original matches" << endl
 			<< "8. Overwrite value" << endl
-			<< "9. Exit" << endl;
+			<< "9. Filter for a group of values" << endl
+			<< "10. Exit" << endl;
 
-		char choice;
-		cin >> choice;
+		string choice_string;
+		cin >> choice_string;
+		int choice = atoi(choice_string.c_str());
 		switch(choice) {
-			case '1':
+			case 1:
 				cout << "List of current processes with their PIDs:" << endl;
-				view_tasklist();
+				view_tasklist(catalog);
 				break;
-			case '2':
+			case 2:
 				cout << "Creating new scan:" << endl;
-				current_scan = create_scan(current_scan, current_pid);
+				current_scan = create_scan(current_scan, current_pid, current_name, catalog);
 				break;
-			case '3':
+			case 3:
 				equal_filter(current_scan);
 				break;
-			case '4':
+			case 4:
 				inc_filter(current_scan);
 				break;
-			case '5':
+			case 5:
 				dec_filter(current_scan);
 				break;
-			case '6':
-				current_scan->print_matches();
+			case 6:
+				show_matches(current_scan);
 				break;
-			case '7':
+			case 7:
 				uncond_filter(current_scan);
 				break;
-			case '8':
+			case 8:
 				overwrite(current_scan);
 				break;
-			case '9':
+			case 9:
+				group_filter(current_scan);
+				break;
+			case 10:
 				cout << "Exiting." << endl;
 				if(current_scan) {
 					delete current_scan;
@@ -541,8 +535,31 @@ int ui_begin() {
 	return 0;
 }
 
+// Usage: memscan [-bench] [-batch <script>] [-engine sync|pipeline|queued] [-largepages]
 int main(int argc, char *argv[]) {
-	return ui_begin();	
+	Read_Engine engine = ENGINE_QUEUED;
+	bool large_pages = false;
+	const char *script_path = NULL;
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if(arg == "-bench") {
+			return run_benchmark();
+		} else if(arg == "-largepages") {
+			large_pages = true;
+		} else if(arg == "-batch" && i + 1 < argc) {
+			script_path = argv[++i];
+		} else if(arg == "-engine" && i + 1 < argc) {
+			string name = argv[++i];
+			if(!parse_engine(name, engine)) {
+				cout << "Unknown engine " << name << endl;
+				return 1;
+			}
+		}
+	}
+	if(script_path) {
+		return run_batch(script_path, engine, large_pages);
+	}
+	return ui_begin(engine, large_pages);
 }
 
 
@@ -0,0 +1,269 @@
+// Memory scanner library. Scans the writable memory of a process and narrows
+// down the locations that agree with a series of conditions.
+// This is the interface front ends build on. The machinery behind it is in memscan_internal.h.
+#ifndef MEMSCAN_H
+#define MEMSCAN_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <windows.h>
+
+typedef enum {
+	COND_UNCONDITIONAL,
+	COND_EQUALS,
+	COND_INCREASED,
+	COND_DECREASED,
+	COND_GROUP
+} Search_Condition;
+
+// How a scan reads the memory of its blocks during an update
+// -ENGINE_SYNC: Read a chunk, compare it, then read the next one.
+// -ENGINE_PIPELINE: One reader thread reads ahead while several threads compare.
+// -ENGINE_QUEUED: Several reader threads keep reads in flight. Chunks are compared in the order they land.
+typedef enum {
+	ENGINE_SYNC,
+	ENGINE_PIPELINE,
+	ENGINE_QUEUED
+} Read_Engine;
+
+// Largest span a group search may cover in bytes
+#define GROUP_MAX_SPAN 256
+
+typedef enum {
+	TYPE_U8,
+	TYPE_U16,
+	TYPE_U32,
+	TYPE_F32
+} Value_Type;
+
+// Member of a group search
+// -offset: Offset of the member from the base of the group.
+// -type: Type of the member's value.
+// -any: Whether the member matches any value. It then only takes up space in the group.
+// -val: Raw bits of the value to look for.
+typedef struct _Group_Member {
+	SIZE_T offset;
+	Value_Type type;
+	bool any;
+	unsigned int val;
+} Group_Member;
+
+// Group search for several values at fixed offsets from a common base, like the fields of a struct
+// -members: Values making up the group.
+// -span: Bytes from the base to the end of the last member.
+// -anchor: Member used to prefilter bases. -1 if every member matches any value.
+// -key_index: Byte of the anchor's value that is searched for.
+// -key: Value of that byte.
+typedef class _Group {
+public:
+	std::vector<Group_Member> members;
+	SIZE_T span;
+	int anchor;
+	SIZE_T key_index;
+	unsigned char key;
+
+	_Group();
+
+	static SIZE_T type_size(Value_Type type);
+
+	void add(SIZE_T offset, Value_Type type, bool any, unsigned int val);
+
+	// Guess how rarely a member's value shows up in memory. Wider values are rarer, small ones are everywhere.
+	static int rarity(const Group_Member &member);
+
+	// Pick the rarest member that has a value as the anchor and a byte of its value that isn't 0x00 or 0xff as the key
+	void choose_anchor();
+
+	// Check every member against the bytes starting at base
+	bool matches_at(const unsigned char *base) const;
+
+} Group;
+
+typedef enum {
+	OUTPUT_TEXT,
+	OUTPUT_CSV,
+	OUTPUT_JSONL,
+	OUTPUT_BINARY
+} Output_Format;
+
+// Bytes buffered by a result writer before they are written out
+#define WRITER_BUFFER_SIZE ( 64*1024 )
+
+// Buffered writer that streams matches out in one of the output formats
+// -out: Stream the results are written to.
+// -format: Format each match is written in. OUTPUT_BINARY writes a little endian
+//	64 bit address followed by a 32 bit value per match.
+// -buffer: Bytes waiting to be written.
+// -used: How many bytes of the buffer are waiting.
+typedef class _Result_Writer {
+public:
+	FILE *out;
+	Output_Format format;
+	std::vector<char> buffer;
+	SIZE_T used;
+
+	_Result_Writer(FILE *out, Output_Format format);
+
+	void write(const char *data, SIZE_T bytes);
+
+	void write_match(unsigned int index, unsigned char *addr, unsigned int val);
+
+	void flush();
+
+	~_Result_Writer();
+
+} Result_Writer;
+
+// Defined in memscan_internal.h
+class _Region_Table;
+
+// Scan of the writable memory of a process
+// -regions: Regions of the process being scanned, with their snapshots and search masks.
+// -engine: How regions are read on each update.
+// -filtered: Whether a filter has run since the last open or reset, so the snapshots hold the values of the matches.
+typedef class _Scan {
+public:
+	_Scan();
+
+	// Initialize the region table with the memory regions of the specified process
+	_Scan(unsigned int pid, int data_size);
+
+	// Take over the writable regions of a process, reusing the memory of the previous scan.
+	// The previous scan is kept if the process can't be opened or has nothing to scan.
+	bool open(unsigned int pid, int data_size);
+
+	// Take over the given regions of a process that is already open, such as a block of this one.
+	// Returns false and keeps the previous scan if there isn't room for them, the caller then still owns hProc.
+	bool open(HANDLE hProc, const std::vector<MEMORY_BASIC_INFORMATION> &regions, int data_size);
+
+	// Update the region table with new conditions. COND_GROUP also takes the group to look for,
+	// and is refused without one. Other conditions ignore the group.
+	bool update(Search_Condition condition, unsigned int val, const Group *group = NULL);
+
+	// Read the chunks an update would read, with the same engine, but compare and keep none of them.
+	// Times the reads on their own next to a full update.
+	void read_regions();
+
+	// Write a value of the scan's data size to an address of the scanned process. Returns false if it couldn't be written.
+	bool poke(unsigned char *addr, unsigned int val);
+
+	// Read a value of the scan's data size from an address of the scanned process. Returns false if it couldn't be read.
+	bool peek(unsigned char *addr, unsigned int &val);
+
+	// Print the info about the regions in the table
+	void scan_dump();
+
+	// Stream the matches from position first in the list of matches, writing at most max of them (0 for all).
+	// Values come from the last snapshot unless live is set, in which case each one is peeked.
+	// Matches that can't be peeked are left out and counted in failed if it is given.
+	// Returns how many matches were written.
+	unsigned int write_matches(Result_Writer &writer, unsigned int first, unsigned int max, bool live, unsigned int *failed = NULL);
+
+	// Print the addresses and current values of every match. Returns how many values couldn't be read.
+	unsigned int print_matches();
+
+	// Get matches through counting search mask values
+	unsigned int get_matches();
+
+	// Get matches through summing the match counts each update keeps, without recounting the masks
+	unsigned int get_matches2();
+
+	// Get the address of the match at a position in the list of matches. NULL if there are fewer matches.
+	unsigned char* get_match(unsigned int index = 0);
+
+	// Get the size of the scanned memory in bytes
+	unsigned int get_size();
+
+	// Get how many regions are in the table
+	int get_blocks();
+
+	// Get the size of the data type the scan looks at
+	int get_data_size();
+
+	// Get how many regions of the last open were left out because no memory could be had for them
+	unsigned int get_dropped();
+
+	// Back the scan's memory with large pages from the next open on. Returns false if large pages can't be used.
+	bool use_large_pages(bool large_pages);
+
+	void set_engine(Read_Engine engine);
+
+	Read_Engine get_engine();
+
+	// Whether a filter has run since the last open or reset
+	bool is_filtered();
+
+	// Check whether the scanned process is still running
+	bool is_alive();
+
+	~_Scan();
+
+private:
+	_Region_Table *regions;
+	Read_Engine engine;
+	bool filtered;
+
+	// Scans own their region table and aren't copied
+	_Scan(const _Scan&);
+	_Scan& operator=(const _Scan&);
+
+} Scan;
+
+// Process seen by the process catalog
+// -pid: Process ID.
+// -name: Name of the executable.
+// -path: Full path of the executable. Empty if the process couldn't be queried.
+// -working_set: Bytes of the process resident in memory as of the last refresh.
+// -created: Creation time of the process. Tells apart processes that reuse a PID.
+// -generation: Refresh the process was last seen in.
+typedef struct _Process_Entry {
+	DWORD pid;
+	std::string name;
+	std::string path;
+	SIZE_T working_set;
+	ULONGLONG created;
+	unsigned int generation;
+} Process_Entry;
+
+// Catalog of the processes on the system, kept in memory between refreshes
+// Each refresh lists every process with a single NtQuerySystemInformation call, which also gives
+// their creation times and working sets. Only processes new to the catalog are opened, to look up their path.
+// -processes: Processes by PID.
+// -generation: How many refreshes have run.
+// -buffer: Buffer the process list is read into, kept between refreshes.
+typedef class _Process_Catalog {
+public:
+	std::map<DWORD, Process_Entry> processes;
+	unsigned int generation;
+	std::vector<unsigned char> buffer;
+
+	_Process_Catalog();
+
+	// Fill in the path of a process, which needs a handle to it
+	static void query(Process_Entry &entry);
+
+	// Bring the catalog up to date with the running processes
+	bool refresh();
+
+	static std::string lower(std::string text);
+
+	// Find a process by its executable name, ignoring case. The most recently started one wins when several match.
+	const Process_Entry* find_by_name(const std::string &name);
+
+	// Find a process by its executable name, or failing that by a regex over its name and path.
+	// The most recently started process wins when several match.
+	const Process_Entry* find(const std::string &pattern);
+
+	const Process_Entry* find(DWORD pid);
+
+	// Print the catalog with the working set of each process
+	void print();
+
+} Process_Catalog;
+
+// Parse a group search such as "u32 100 at +0, f32 1.5 at +8, u16 any at +12 within 64 bytes"
+bool parse_group(const std::string &text, Group &group);
+
+#endif
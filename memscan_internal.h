@@ -0,0 +1,281 @@
+// Internals of the memory scanner library: the region table, its arenas and the read pipeline.
+// Only the library itself includes this. Front ends use memscan.h.
+#ifndef MEMSCAN_INTERNAL_H
+#define MEMSCAN_INTERNAL_H
+
+#include "memscan.h"
+
+#define WRITABLE ( PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY )
+
+// Bytes read per chunk, how many spare chunk buffers the readers may fill ahead of the compare stage,
+// how many reads the queued engine keeps in flight and how many threads compare chunks
+#define CHUNK_SIZE ( 128*1024 )
+#define PIPELINE_DEPTH 16
+#define QUEUE_DEPTH 4
+#define COMPARE_WORKERS 2
+
+// Read bytes from a process's memory. Every read of the target goes through here.
+bool read_memory(HANDLE hProc, unsigned char *addr, void *dest, SIZE_T bytes);
+
+// Clear every bit of the mask in [from, to)
+void clear_mask(unsigned char *mask, SIZE_T from, SIZE_T to);
+
+// Set the bit of every offset that is a multiple of data_size in [0, size)
+void fill_mask(unsigned char *mask, SIZE_T size, int data_size);
+
+// Count the bits set in a mask of size bytes
+unsigned int count_mask(const unsigned char *mask, SIZE_T size);
+
+// Allocations are aligned to a cache line, pages are committed a megabyte at a time
+// and address space is reserved in segments of at least ARENA_SEGMENT_SIZE, or
+// MASK_SEGMENT_SIZE for the masks, which are an eighth the size of the snapshots
+#define ARENA_ALIGN 64
+#define ARENA_COMMIT_STEP ( 1024*1024 )
+#define ARENA_SEGMENT_SIZE ( 64*1024*1024 )
+#define MASK_SEGMENT_SIZE ( ARENA_SEGMENT_SIZE / 8 )
+
+// Range of reserved address space in an arena
+// -base: Start of the reserved address space.
+// -reserved: How many bytes of address space are reserved.
+// -committed: How many bytes from the front are committed.
+// -used: How many bytes from the front have been handed out.
+typedef struct _Arena_Segment {
+	unsigned char *base;
+	SIZE_T reserved;
+	SIZE_T committed;
+	SIZE_T used;
+} Arena_Segment;
+
+// Address space handed out front to back and given back all at once
+// It is reserved in segments rather than one range, since a 32 bit process rarely has
+// a single free range as large as the memory of a big target.
+// -segments: Reserved ranges of address space.
+// -current: Segment allocations are handed out from.
+// -segment_size: Smallest segment reserved. Large pages commit a whole segment up front.
+// -large_pages: Whether to try backing new segments with large pages. Needs SeLockMemoryPrivilege enabled.
+typedef class _Arena {
+public:
+	std::vector<Arena_Segment> segments;
+	unsigned int current;
+	SIZE_T segment_size;
+	bool large_pages;
+
+	_Arena();
+
+	// Round bytes up the way alloc pads allocations
+	static SIZE_T padded(SIZE_T bytes);
+
+	// Reserve more address space until the arena holds at least bytes in total, in segments
+	// big enough for allocations of up to largest bytes.
+	// Allocations already handed out are left alone, and nothing new is kept if it fails.
+	bool reserve(SIZE_T bytes, SIZE_T largest);
+
+	// Start handing out from the front again. Reserved and committed pages are kept for reuse.
+	void reset();
+
+	// Hand out bytes, committing pages as they are first needed. NULL if no more memory can be had.
+	unsigned char* alloc(SIZE_T bytes);
+
+	void release();
+
+	~_Arena();
+
+private:
+	bool add_segment(SIZE_T bytes);
+
+	// Arenas own their address space and aren't copied
+	_Arena(const _Arena&);
+	_Arena& operator=(const _Arena&);
+
+} Arena;
+
+// A chunk of a region handed from the reader stage to the compare stage
+// -region: Index of the region in the region table.
+// -offset: Offset of the chunk in the region.
+// -buffer: Spare buffer the chunk was read into.
+// -ok: Whether the chunk was read.
+typedef struct _Chunk {
+	unsigned int region;
+	SIZE_T offset;
+	unsigned char *buffer;
+	bool ok;
+} Chunk;
+
+// Table of the memory regions of a process, stored one column per field
+// Snapshots and search masks live in two arenas, so a new scan reuses the memory of the last one.
+// -hproc: Handle of the process the regions belong to.
+// -data_size: The size of the data type of concern. ex. 1 for unsigned char and 4 for int.
+// -base: Base address of each region in the process's virtual address space.
+// -size: Size of each region of pages with similar attributes.
+// -matches: How many matches each region has that agree with the conditions placed.
+// -first_piece: Index of each region's first snapshot piece in pieces.
+// -mask: Each region's search mask in the mask arena.
+// -chunks_left: How many chunks of each region have not been compared yet in the current update.
+// -pieces: Last snapshot of every region, one piece per chunk. The pieces of a region are consecutive.
+// -failed: Whether the chunk of each piece couldn't be read in the current update.
+// -spares: Chunk buffers free to be read into. A chunk that has been compared takes the place of its
+//	snapshot piece and the piece becomes a spare, so updates neither copy chunks nor need a second snapshot.
+//	Only the short last chunk of a region is copied into its piece, since spares must hold a full chunk.
+// -snapshots: Arena holding the snapshots and spares.
+// -masks: Arena holding the search masks.
+// -dropped: How many regions of the last reset were left out because no memory could be had for them.
+typedef class _Region_Table {
+public:
+	HANDLE hProc;
+	int data_size;
+	std::vector<unsigned char*> base;
+	std::vector<SIZE_T> size;
+	std::vector<unsigned int> matches;
+	std::vector<unsigned int> first_piece;
+	std::vector<unsigned char*> mask;
+	std::vector<LONG> chunks_left;
+	std::vector<unsigned char*> pieces;
+	std::vector<unsigned char> failed;
+	std::vector<unsigned char*> spares;
+	Arena snapshots;
+	Arena masks;
+	unsigned int dropped;
+
+	_Region_Table();
+
+	// Drop every region and take over the regions of a process. data_size must be 1, 2 or 4.
+	// Returns false and keeps the current regions if there isn't room for the new ones,
+	// otherwise the table owns the handle from here on.
+	bool reset(HANDLE hProc, const std::vector<MEMORY_BASIC_INFORMATION> &regions, int data_size);
+
+	// Back the arenas with large pages. Enables SeLockMemoryPrivilege for the process first,
+	// which only works if the account holds it. Returns false if large pages can't be used.
+	// Takes effect on the next reset.
+	bool use_large_pages(bool large_pages);
+
+	unsigned int count();
+
+	// Index in pieces of the piece holding the chunk at offset
+	unsigned int piece_index(unsigned int r, SIZE_T offset);
+
+	// Address of the byte at offset in a region's last snapshot
+	unsigned char* snapshot_at(unsigned int r, SIZE_T offset);
+
+	unsigned char* mask_of(unsigned int r);
+
+	// Check whether the byte of interest is marked present in the search mask
+	bool is_in_search(unsigned int r, SIZE_T offset);
+
+	// Mark every piece of data of a region as a match again
+	void reset_region(unsigned int r);
+
+	// How many chunks a region is read in
+	unsigned int get_chunks(unsigned int r);
+
+	// How many bytes the chunk starting at offset covers
+	SIZE_T chunk_bytes(unsigned int r, SIZE_T offset);
+
+	// Prepare a region for an update. Called once per region before any of its chunks is compared.
+	void begin_update(unsigned int r);
+
+	// Read the chunk at offset into a spare buffer. Returns false if the read failed or came up short.
+	bool read_chunk(unsigned int r, SIZE_T offset, unsigned char *buffer);
+
+	// Compare a chunk that has been read against the previous snapshot and the condition
+	// Chunks of a region may be compared by several threads at once, each touching only its own part of the mask.
+	void compare_chunk(unsigned int r, SIZE_T start, const unsigned char *buffer, Search_Condition condition,
+		unsigned int val, const Group *group);
+
+	// Compare the group bases of a chunk whose members all lie inside the chunk
+	// The anchor's key byte is found with memchr, so only bases where it lines up are checked in full.
+	// Bases closer than the group's span to the end of the chunk are left for finish_group.
+	void compare_group(unsigned int r, SIZE_T start, const unsigned char *buffer, const Group *group);
+
+	// Make a compared chunk the region's snapshot of it. Returns the buffer that is spare now:
+	// the old piece if the chunk took its place, or the chunk's own buffer if it was copied.
+	unsigned char* keep_chunk(unsigned int r, SIZE_T start, unsigned char *buffer);
+
+	// Compare the group bases left over at the end of each chunk once the whole region has been kept
+	void finish_group(unsigned int r, const Group *group);
+
+	// Drop a chunk that couldn't be read. Nothing in it can match and it keeps its previous snapshot.
+	void fail_chunk(unsigned int r, SIZE_T start);
+
+	// Account for a chunk that has been kept or dropped, finishing the update after the last one
+	void finish_chunk(unsigned int r, const Group *group);
+
+	// Read every chunk of a region into a spare without comparing or keeping it, one chunk after the other
+	void read_region(unsigned int r);
+
+	// Update a region with which bytes the condition specifies, one chunk after the other
+	void update_region(unsigned int r, Search_Condition condition, unsigned int val, const Group *group);
+
+	~_Region_Table();
+
+} Region_Table;
+
+// Reads and compares regions as a two stage pipeline
+// Reader threads read chunks into the spare buffers of the region table while compare workers,
+// the calling thread among them, compare the chunks that have landed and keep them as the new snapshot.
+// Each kept chunk frees a spare, so the number of spares bounds how far the readers can run ahead
+// and both stages are kept busy instead of taking turns. Chunks are compared in whatever order
+// their reads complete.
+// -jobs: Every chunk to read, in region order.
+// -next_job: Next job a reader claims.
+// -next_compare: How many chunks the compare workers have claimed.
+// -ring: Chunks that have been read and wait to be compared. Never holds more than there are spares.
+// -lock: Guards the ring and the spares.
+// -free_spares: Counts the spares the readers can take.
+// -full_slots: Counts the chunks waiting in the ring.
+// -read_only: Whether chunks are handed back as soon as they land, leaving the regions untouched.
+typedef class _Pipeline {
+public:
+	Region_Table *regions;
+	std::vector<Chunk> jobs;
+	volatile LONG next_job;
+	volatile LONG next_compare;
+	Chunk ring[PIPELINE_DEPTH];
+	unsigned int write_slot;
+	unsigned int read_slot;
+	CRITICAL_SECTION lock;
+	HANDLE free_spares;
+	HANDLE full_slots;
+	Search_Condition condition;
+	unsigned int val;
+	const Group *group;
+	bool read_only;
+
+	// Collect the chunks of the regions that still have possible matches
+	_Pipeline(Region_Table *regions);
+
+	// Reader stage: take a spare to read into, waiting until one is free
+	unsigned char* take_spare();
+
+	// Compare stage: hand a buffer back to the readers
+	void give_spare(unsigned char *buffer);
+
+	// Reader stage: hand a chunk to the compare stage
+	void push(Chunk chunk);
+
+	// Compare stage: take the next chunk that has been read, waiting until there is one
+	Chunk pop();
+
+	// Reader stage: keep claiming and reading chunks until there are none left
+	void read_all();
+
+	static DWORD WINAPI reader_proc(LPVOID param);
+
+	// Compare stage: compare and keep a chunk that has been read, or drop it if the read failed
+	void compare(Chunk chunk);
+
+	// Compare stage: keep claiming chunks to compare until every one has been claimed
+	void compare_all();
+
+	static DWORD WINAPI compare_proc(LPVOID param);
+
+	// Run both stages with the given number of readers and compare workers until every chunk has been compared
+	void run(Search_Condition condition, unsigned int val, const Group *group, unsigned int readers, unsigned int workers);
+
+	// Run the reader stage on its own with the given number of readers, dropping every chunk once it is read
+	void read(unsigned int readers);
+
+	~_Pipeline();
+
+} Pipeline;
+
+#endif
@@ -0,0 +1,1335 @@
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <sstream>
+#include <regex>
+#include "memscan_internal.h"
+
+using namespace std;
+
+// Search mask helpers. The mask holds one bit per byte of a region.
+#define IS_IN_MASK(mask, offset) ((mask)[(offset)/8] & (1<<((offset) % 8)))
+#define ADD_TO_MASK(mask, offset) ((mask)[(offset)/8] |= (1<<((offset) % 8)))
+#define REMOVE_FROM_MASK(mask, offset) ((mask)[(offset)/8] &= ~(1<<((offset) % 8)))
+
+
+// Read bytes from a process's memory. Every read of the target goes through here.
+bool read_memory(HANDLE hProc, unsigned char *addr, void *dest, SIZE_T bytes) {
+	SIZE_T bytes_read = 0;
+	if(ReadProcessMemory(hProc, addr, dest, bytes, &bytes_read)) {
+		return bytes_read == bytes;
+	}
+	return false;
+}
+
+// Clear every bit of the mask in [from, to)
+void clear_mask(unsigned char *mask, SIZE_T from, SIZE_T to) {
+	while(from < to && from % 8) {
+		REMOVE_FROM_MASK(mask, from);
+		from++;
+	}
+	if(from < to) {
+		memset(mask + from / 8, 0, (to - from) / 8);
+		from += (to - from) / 8 * 8;
+	}
+	while(from < to) {
+		REMOVE_FROM_MASK(mask, from);
+		from++;
+	}
+}
+
+// Set the bit of every offset that is a multiple of data_size in [0, size)
+void fill_mask(unsigned char *mask, SIZE_T size, int data_size) {
+	unsigned char pattern;
+	switch(data_size) {
+		case 1:
+			pattern = 0xff;
+			break;
+		case 2:
+			pattern = 0x55;
+			break;
+		case 4:
+		default:
+			pattern = 0x11;
+			break;
+	}
+	memset(mask, pattern, size / 8);
+	for(SIZE_T offset = size / 8 * 8; offset < size; offset += data_size) {
+		ADD_TO_MASK(mask, offset);
+	}
+}
+
+// Count the bits set in a mask of size bytes
+unsigned int count_mask(const unsigned char *mask, SIZE_T size) {
+	unsigned int count = 0;
+	for(SIZE_T i = 0; i < (size + 7) / 8; i++) {
+		unsigned char bits = mask[i];
+		while(bits) {
+			bits &= bits - 1;
+			count++;
+		}
+	}
+	return count;
+}
+
+// Parse a whole token as an unsigned number no larger than max
+static bool parse_number(const string &text, unsigned long long max, unsigned long long &number) {
+	char *end;
+	if(text.empty() || text[0] == '-') {
+		return false;
+	}
+	errno = 0;
+	number = strtoull(text.c_str(), &end, 0);
+	return *end == '\0' && errno == 0 && number <= max;
+}
+
+// Parse a group search such as "u32 100 at +0, f32 1.5 at +8, u16 any at +12 within 64 bytes"
+bool parse_group(const string &text, Group &group) {
+	unsigned long long within = GROUP_MAX_SPAN;
+	bool closed = false;
+	istringstream parts(text);
+	string part;
+	while(getline(parts, part, ',')) {
+		istringstream tokens(part);
+		// Nothing may follow the member that closed the group
+		if(closed) {
+			return false;
+		}
+		string type_name, val_string, at, offset_string, word;
+		if(!(tokens >> type_name >> val_string >> at >> offset_string) || at != "at") {
+			return false;
+		}
+
+		Value_Type type;
+		if(type_name == "u8") {
+			type = TYPE_U8;
+		} else if(type_name == "u16") {
+			type = TYPE_U16;
+		} else if(type_name == "u32") {
+			type = TYPE_U32;
+		} else if(type_name == "f32") {
+			type = TYPE_F32;
+		} else {
+			return false;
+		}
+
+		// Values have to fit the member's type
+		bool any = (val_string == "any");
+		unsigned int val = 0;
+		unsigned long long number;
+		if(!any && type == TYPE_F32) {
+			char *end;
+			float temp_val = (float) strtod(val_string.c_str(), &end);
+			// A NaN never equals anything, so the member could never match
+			if(*end != '\0' || temp_val != temp_val) {
+				return false;
+			}
+			memcpy(&val, &temp_val, sizeof(float));
+		} else if(!any) {
+			unsigned long long max = (1ULL << (8 * Group::type_size(type))) - 1;
+			if(!parse_number(val_string, max, number)) {
+				return false;
+			}
+			val = (unsigned int) number;
+		}
+		if(!parse_number(offset_string, GROUP_MAX_SPAN, number)) {
+			return false;
+		}
+		group.add((SIZE_T) number, type, any, val);
+
+		// The last member may close the group with "within <n> [bytes]"
+		if(tokens >> word) {
+			string within_string;
+			if(word != "within" || !(tokens >> within_string) || !parse_number(within_string, GROUP_MAX_SPAN, within)) {
+				return false;
+			}
+			if(tokens >> word && (word != "bytes" || tokens >> word)) {
+				return false;
+			}
+			closed = true;
+		}
+	}
+	if(group.members.empty() || group.span > within || group.span > GROUP_MAX_SPAN) {
+		return false;
+	}
+	group.choose_anchor();
+	return true;
+}
+
+_Group::_Group() {
+	span = 0;
+	anchor = -1;
+	key_index = 0;
+	key = 0;
+}
+
+SIZE_T _Group::type_size(Value_Type type) {
+	switch(type) {
+		case TYPE_U8:
+			return 1;
+		case TYPE_U16:
+			return 2;
+		case TYPE_U32:
+		case TYPE_F32:
+		default:
+			return 4;
+	}
+}
+
+void _Group::add(SIZE_T offset, Value_Type type, bool any, unsigned int val) {
+	// -0.0 is stored as 0.0 so an anchor on it keys on the 0x00 byte both zeros share
+	if(type == TYPE_F32 && val == 0x80000000) {
+		val = 0;
+	}
+	Group_Member member = { offset, type, any, val };
+	members.push_back(member);
+	if(offset + type_size(type) > span) {
+		span = offset + type_size(type);
+	}
+}
+
+int _Group::rarity(const Group_Member &member) {
+	if(member.any) {
+		return -1;
+	}
+	int score = (int) type_size(member.type) * 2;
+	if(member.type == TYPE_F32) {
+		score++;
+	}
+	if(member.val <= 1 || member.val == 0xffffffff) {
+		score -= 8;
+	}
+	return score;
+}
+
+void _Group::choose_anchor() {
+	anchor = -1;
+	for(unsigned int i = 0; i < members.size(); i++) {
+		// Common values still make an anchor when nothing rarer is left, so -1 only means every member is any
+		if(!members[i].any && (anchor < 0 || rarity(members[i]) > rarity(members[anchor]))) {
+			anchor = i;
+		}
+	}
+	if(anchor >= 0) {
+		unsigned char bytes[4];
+		memcpy(bytes, &members[anchor].val, sizeof(bytes));
+		key_index = 0;
+		for(SIZE_T i = 0; i < type_size(members[anchor].type); i++) {
+			if(bytes[i] != 0x00 && bytes[i] != 0xff) {
+				key_index = i;
+				break;
+			}
+		}
+		key = bytes[key_index];
+	}
+}
+
+bool _Group::matches_at(const unsigned char *base) const {
+	for(unsigned int i = 0; i < members.size(); i++) {
+		const Group_Member &member = members[i];
+		if(member.any) {
+			continue;
+		}
+		const unsigned char *data = base + member.offset;
+		bool is_match = false;
+		switch(member.type) {
+			case TYPE_U8:
+				is_match = (*data == member.val);
+				break;
+			case TYPE_U16:
+				is_match = (*((unsigned short*) data) == member.val);
+				break;
+			case TYPE_U32:
+				is_match = (*((unsigned int*) data) == member.val);
+				break;
+			case TYPE_F32:
+				{
+					// Compared bit for bit like the anchor's key byte, except that both zeros are equal
+					unsigned int bits = *((unsigned int*) data);
+					is_match = (bits == member.val) || ((bits | member.val) & 0x7fffffff) == 0;
+				}
+				break;
+		}
+		if(!is_match) {
+			return false;
+		}
+	}
+	return true;
+}
+
+_Arena::_Arena() {
+	current = 0;
+	segment_size = ARENA_SEGMENT_SIZE;
+	large_pages = false;
+}
+
+SIZE_T _Arena::padded(SIZE_T bytes) {
+	return (bytes + ARENA_ALIGN - 1) & ~((SIZE_T) ARENA_ALIGN - 1);
+}
+
+bool _Arena::add_segment(SIZE_T bytes) {
+	Arena_Segment segment = { NULL, 0, 0, 0 };
+	if(bytes < this->segment_size) {
+		bytes = this->segment_size;
+	}
+
+	// Large pages have to be committed up front
+	if(this->large_pages) {
+		SIZE_T page = GetLargePageMinimum();
+		if(page) {
+			SIZE_T rounded = (bytes + page - 1) / page * page;
+			segment.base = (unsigned char*) VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if(segment.base) {
+				segment.reserved = rounded;
+				segment.committed = rounded;
+			}
+		}
+	}
+	if(!segment.base) {
+		segment.base = (unsigned char*) VirtualAlloc(NULL, bytes, MEM_RESERVE, PAGE_READWRITE);
+		segment.reserved = bytes;
+	}
+	if(!segment.base) {
+		return false;
+	}
+	this->segments.push_back(segment);
+	return true;
+}
+
+bool _Arena::reserve(SIZE_T bytes, SIZE_T largest) {
+	unsigned int had = this->segments.size();
+	SIZE_T total = 0;
+	for(unsigned int i = 0; i < this->segments.size(); i++) {
+		total += this->segments[i].reserved;
+	}
+	while(total < bytes) {
+		if(!add_segment(largest)) {
+			// Give back what this call reserved
+			while(this->segments.size() > had) {
+				VirtualFree(this->segments.back().base, 0, MEM_RELEASE);
+				this->segments.pop_back();
+			}
+			return false;
+		}
+		total += this->segments.back().reserved;
+	}
+	return true;
+}
+
+void _Arena::reset() {
+	for(unsigned int i = 0; i < this->segments.size(); i++) {
+		this->segments[i].used = 0;
+	}
+	this->current = 0;
+}
+
+unsigned char* _Arena::alloc(SIZE_T bytes) {
+	while(1) {
+		if(this->current == this->segments.size() && !add_segment(padded(bytes))) {
+			return NULL;
+		}
+		Arena_Segment &segment = this->segments[this->current];
+		SIZE_T offset = padded(segment.used);
+		if(offset <= segment.reserved && bytes <= segment.reserved - offset) {
+			if(offset + bytes > segment.committed) {
+				SIZE_T grow = (offset + bytes - segment.committed + ARENA_COMMIT_STEP - 1) / ARENA_COMMIT_STEP * ARENA_COMMIT_STEP;
+				if(grow > segment.reserved - segment.committed) {
+					grow = segment.reserved - segment.committed;
+				}
+				if(!VirtualAlloc(segment.base + segment.committed, grow, MEM_COMMIT, PAGE_READWRITE)) {
+					return NULL;
+				}
+				segment.committed += grow;
+			}
+			segment.used = offset + bytes;
+			return segment.base + offset;
+		}
+		// Whatever is left of this segment is too small, move on to the next one
+		this->current++;
+	}
+}
+
+void _Arena::release() {
+	for(unsigned int i = 0; i < this->segments.size(); i++) {
+		VirtualFree(this->segments[i].base, 0, MEM_RELEASE);
+	}
+	this->segments.clear();
+	this->current = 0;
+}
+
+_Arena::~_Arena() {
+	release();
+}
+
+_Region_Table::_Region_Table() {
+	hProc = NULL;
+	data_size = 4;
+	dropped = 0;
+	masks.segment_size = MASK_SEGMENT_SIZE;
+}
+
+bool _Region_Table::reset(HANDLE hProc, const vector<MEMORY_BASIC_INFORMATION> &regions, int data_size) {
+	if(data_size != 1 && data_size != 2 && data_size != 4) {
+		return false;
+	}
+
+	// Work out the room the new regions need without overflowing SIZE_T on a 32 bit build.
+	// Snapshots hold every region once, plus the spare chunks.
+	SIZE_T snapshot_bytes = PIPELINE_DEPTH * CHUNK_SIZE;
+	SIZE_T mask_bytes = 0;
+	SIZE_T largest = CHUNK_SIZE;
+	for(unsigned int i = 0; i < regions.size(); i++) {
+		SIZE_T region_bytes = Arena::padded(regions[i].RegionSize);
+		if(region_bytes < regions[i].RegionSize || region_bytes > (SIZE_T) -1 - snapshot_bytes) {
+			return false;
+		}
+		snapshot_bytes += region_bytes;
+		mask_bytes += Arena::padded((regions[i].RegionSize + 7) / 8);
+		if(region_bytes > largest) {
+			largest = region_bytes;
+		}
+	}
+	if(!snapshots.reserve(snapshot_bytes, largest) || !masks.reserve(mask_bytes, (largest + 7) / 8)) {
+		return false;
+	}
+
+	// From here on the previous regions are replaced
+	if(this->hProc && this->hProc != hProc) {
+		CloseHandle(this->hProc);
+	}
+	this->hProc = hProc;
+	this->data_size = data_size;
+	this->dropped = 0;
+	base.clear();
+	size.clear();
+	matches.clear();
+	first_piece.clear();
+	mask.clear();
+	chunks_left.clear();
+	pieces.clear();
+	failed.clear();
+	spares.clear();
+	snapshots.reset();
+	masks.reset();
+
+	for(unsigned int i = 0; i < PIPELINE_DEPTH; i++) {
+		unsigned char *spare = snapshots.alloc(CHUNK_SIZE);
+		if(!spare) {
+			this->dropped = regions.size();
+			return true;
+		}
+		spares.push_back(spare);
+	}
+
+	for(unsigned int i = 0; i < regions.size(); i++) {
+		SIZE_T region_size = regions[i].RegionSize;
+		unsigned char *snapshot_buffer = snapshots.alloc(region_size);
+		unsigned char *mask_buffer = snapshot_buffer ? masks.alloc((region_size + 7) / 8) : NULL;
+		if(!mask_buffer) {
+			this->dropped = regions.size() - i;
+			break;
+		}
+		memset(snapshot_buffer, 0, region_size);
+		fill_mask(mask_buffer, region_size, data_size);
+
+		base.push_back((unsigned char*) regions[i].BaseAddress);
+		size.push_back(region_size);
+		matches.push_back(region_size / data_size);
+		first_piece.push_back(pieces.size());
+		mask.push_back(mask_buffer);
+		chunks_left.push_back(0);
+		// The pieces start out side by side in the region's snapshot and scatter as chunks are kept
+		for(SIZE_T offset = 0; offset < region_size; offset += CHUNK_SIZE) {
+			pieces.push_back(snapshot_buffer + offset);
+			failed.push_back(0);
+		}
+	}
+	return true;
+}
+
+bool _Region_Table::use_large_pages(bool large_pages) {
+	if(large_pages) {
+		// Large pages need SeLockMemoryPrivilege enabled in the process token, not just granted
+		HANDLE hToken;
+		TOKEN_PRIVILEGES privileges;
+		large_pages = GetLargePageMinimum() != 0
+			&& OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken);
+		if(large_pages) {
+			privileges.PrivilegeCount = 1;
+			privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			large_pages = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+				&& AdjustTokenPrivileges(hToken, false, &privileges, 0, NULL, NULL)
+				&& GetLastError() != ERROR_NOT_ALL_ASSIGNED;
+			CloseHandle(hToken);
+		}
+	}
+	snapshots.large_pages = large_pages;
+	masks.large_pages = large_pages;
+	return large_pages;
+}
+
+unsigned int _Region_Table::count() {
+	return base.size();
+}
+
+unsigned int _Region_Table::piece_index(unsigned int r, SIZE_T offset) {
+	return first_piece[r] + offset / CHUNK_SIZE;
+}
+
+unsigned char* _Region_Table::snapshot_at(unsigned int r, SIZE_T offset) {
+	return pieces[piece_index(r, offset)] + offset % CHUNK_SIZE;
+}
+
+unsigned char* _Region_Table::mask_of(unsigned int r) {
+	return mask[r];
+}
+
+bool _Region_Table::is_in_search(unsigned int r, SIZE_T offset) {
+	if(offset < size[r]) {
+		return IS_IN_MASK(mask_of(r), offset);
+	} else {
+		return false;
+	}
+}
+
+void _Region_Table::reset_region(unsigned int r) {
+	fill_mask(mask_of(r), size[r], data_size);
+	matches[r] = size[r] / data_size;
+}
+
+unsigned int _Region_Table::get_chunks(unsigned int r) {
+	return (size[r] + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+SIZE_T _Region_Table::chunk_bytes(unsigned int r, SIZE_T offset) {
+	SIZE_T bytes_left = size[r] - offset;
+	return (bytes_left < CHUNK_SIZE) ? bytes_left : CHUNK_SIZE;
+}
+
+void _Region_Table::begin_update(unsigned int r) {
+	matches[r] = 0;
+	chunks_left[r] = get_chunks(r);
+	memset(&failed[first_piece[r]], 0, get_chunks(r));
+}
+
+bool _Region_Table::read_chunk(unsigned int r, SIZE_T offset, unsigned char *buffer) {
+	return read_memory(hProc, base[r] + offset, buffer, chunk_bytes(r, offset));
+}
+
+void _Region_Table::compare_chunk(unsigned int r, SIZE_T start, const unsigned char *buffer, Search_Condition condition,
+	unsigned int val, const Group *group) {
+	if(condition == COND_GROUP) {
+		compare_group(r, start, buffer, group);
+		return;
+	}
+
+	SIZE_T bytes = chunk_bytes(r, start);
+	// The previous snapshot of this chunk, lined up with the new one
+	const unsigned char *prev_buffer = pieces[piece_index(r, start)];
+	// The mask is indexed by offset in the region, so shift it so both buffers line up with it
+	unsigned char *searchmask = mask_of(r) + start / 8;
+	// Kept in locals since writes through the mask could alias any member
+	int data_size = this->data_size;
+	unsigned int found = 0;
+
+	// Iterate through the chunk, incrementing by the data size (unsigned char(1)/short(2)/int(4))
+	for(SIZE_T offset = 0; offset < bytes; offset += data_size) {
+		// Skip a whole byte of the mask at once when nothing in it is left
+		if(offset % 8 == 0 && searchmask[offset / 8] == 0) {
+			offset += 8 - data_size;
+			continue;
+		}
+		if(IS_IN_MASK(searchmask, offset)) {
+			bool is_match = false;
+			unsigned int temp_val;
+			unsigned int prev_val = 0;
+
+			// Read the value from the buffer depending on data size
+			switch(data_size) {
+				case 1:
+					temp_val = *((unsigned char*) &buffer[offset]);
+					prev_val = *((unsigned char*) &prev_buffer[offset]);
+					break;
+				case 2:
+					temp_val = *((unsigned short*) &buffer[offset]);
+					prev_val = *((unsigned short*) &prev_buffer[offset]);
+					break;
+				case 4:
+				default:
+					temp_val = *((unsigned int*) &buffer[offset]);
+					prev_val = *((unsigned int*) &prev_buffer[offset]);
+					break;
+			}
+
+			// Update matches in the buffer based on condition
+			switch(condition) {
+				case COND_EQUALS:
+					is_match = (temp_val == val);
+					break;
+				case COND_INCREASED:
+					is_match = (prev_val < temp_val);
+					break;
+				case COND_DECREASED:
+					is_match = (prev_val > temp_val);
+					break;
+				default:
+					break;
+			}
+
+			if(is_match) {
+				found++;
+			} else {
+				REMOVE_FROM_MASK(searchmask, offset);
+			}
+		}
+	}
+	InterlockedExchangeAdd((volatile LONG*) &matches[r], (LONG) found);
+}
+
+void _Region_Table::compare_group(unsigned int r, SIZE_T start, const unsigned char *buffer, const Group *group) {
+	SIZE_T bytes = chunk_bytes(r, start);
+	// Shifted like in compare_chunk so offsets in the chunk index the mask
+	unsigned char *searchmask = mask_of(r) + start / 8;
+	unsigned int found = 0;
+	if(bytes < group->span) {
+		return;
+	}
+	SIZE_T limit = bytes - group->span + 1;
+
+	// Without an anchor every base that fits is a match
+	if(group->anchor < 0) {
+		for(SIZE_T offset = 0; offset < limit; offset += data_size) {
+			if(IS_IN_MASK(searchmask, offset)) {
+				found++;
+			}
+		}
+		InterlockedExchangeAdd((volatile LONG*) &matches[r], (LONG) found);
+		return;
+	}
+
+	SIZE_T key_pos = group->members[group->anchor].offset + group->key_index;
+	const unsigned char *scan_from = buffer + key_pos;
+	const unsigned char *scan_end = buffer + limit + key_pos;
+	SIZE_T cleared = 0;
+	while(scan_from < scan_end) {
+		const unsigned char *hit = (const unsigned char*) memchr(scan_from, group->key, scan_end - scan_from);
+		if(!hit) {
+			break;
+		}
+		SIZE_T offset = (hit - buffer) - key_pos;
+		scan_from = hit + 1;
+		if(IS_IN_MASK(searchmask, offset)) {
+			// Every base between the previous hit and this one is out
+			clear_mask(searchmask, cleared, offset);
+			if(group->matches_at(buffer + offset)) {
+				found++;
+			} else {
+				REMOVE_FROM_MASK(searchmask, offset);
+			}
+			cleared = offset + 1;
+		}
+	}
+	clear_mask(searchmask, cleared, limit);
+	InterlockedExchangeAdd((volatile LONG*) &matches[r], (LONG) found);
+}
+
+unsigned char* _Region_Table::keep_chunk(unsigned int r, SIZE_T start, unsigned char *buffer) {
+	unsigned char *&piece = pieces[piece_index(r, start)];
+	if(chunk_bytes(r, start) < CHUNK_SIZE) {
+		memcpy(piece, buffer, chunk_bytes(r, start));
+		return buffer;
+	}
+	unsigned char *old_piece = piece;
+	piece = buffer;
+	return old_piece;
+}
+
+void _Region_Table::finish_group(unsigned int r, const Group *group) {
+	unsigned char *searchmask = mask_of(r);
+	// Bases near the end of a chunk reach into the next piece, so their bytes are gathered here first
+	unsigned char window[2 * GROUP_MAX_SPAN];
+	for(SIZE_T start = 0; start < size[r]; start += CHUNK_SIZE) {
+		SIZE_T end = start + chunk_bytes(r, start);
+		SIZE_T tail = (end < start + group->span) ? start : end - group->span + 1;
+		SIZE_T window_end = (end + group->span - 1 < size[r]) ? end + group->span - 1 : size[r];
+		for(SIZE_T pos = tail; pos < window_end;) {
+			SIZE_T piece_end = (pos / CHUNK_SIZE + 1) * CHUNK_SIZE;
+			if(piece_end > window_end) {
+				piece_end = window_end;
+			}
+			memcpy(window + (pos - tail), snapshot_at(r, pos), piece_end - pos);
+			pos = piece_end;
+		}
+		for(SIZE_T offset = tail; offset < end; offset++) {
+			if(!IS_IN_MASK(searchmask, offset)) {
+				continue;
+			}
+			// The base is out if the group runs past the region or into a chunk that couldn't be read
+			bool is_match = (offset + group->span <= size[r])
+				&& !failed[piece_index(r, offset + group->span - 1)];
+			if(is_match && group->matches_at(window + (offset - tail))) {
+				matches[r]++;
+			} else {
+				REMOVE_FROM_MASK(searchmask, offset);
+			}
+		}
+	}
+}
+
+void _Region_Table::fail_chunk(unsigned int r, SIZE_T start) {
+	clear_mask(mask_of(r), start, start + chunk_bytes(r, start));
+	failed[piece_index(r, start)] = 1;
+}
+
+void _Region_Table::finish_chunk(unsigned int r, const Group *group) {
+	if(InterlockedDecrement(&chunks_left[r]) == 0 && group) {
+		finish_group(r, group);
+	}
+}
+
+void _Region_Table::read_region(unsigned int r) {
+	if(matches[r] > 0) {
+		for(SIZE_T offset = 0; offset < size[r]; offset += CHUNK_SIZE) {
+			read_chunk(r, offset, spares.back());
+		}
+	}
+}
+
+void _Region_Table::update_region(unsigned int r, Search_Condition condition, unsigned int val, const Group *group) {
+	// Only check if there are at least some matches possible
+	if(matches[r] > 0) {
+		begin_update(r);
+		unsigned char *buffer = spares.back();
+		for(SIZE_T offset = 0; offset < size[r]; offset += CHUNK_SIZE) {
+			if(read_chunk(r, offset, buffer)) {
+				compare_chunk(r, offset, buffer, condition, val, group);
+				buffer = keep_chunk(r, offset, buffer);
+			} else {
+				fail_chunk(r, offset);
+			}
+			finish_chunk(r, group);
+		}
+		spares.back() = buffer;
+	}
+}
+
+_Region_Table::~_Region_Table() {
+	if(hProc) {
+		CloseHandle(hProc);
+	}
+}
+
+_Pipeline::_Pipeline(Region_Table *regions) {
+	this->regions = regions;
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		if(regions->matches[r] > 0) {
+			for(SIZE_T offset = 0; offset < regions->size[r]; offset += CHUNK_SIZE) {
+				Chunk job = { r, offset, NULL, false };
+				jobs.push_back(job);
+			}
+		}
+	}
+	next_job = 0;
+	next_compare = 0;
+	write_slot = 0;
+	read_slot = 0;
+	read_only = false;
+	InitializeCriticalSection(&lock);
+	free_spares = CreateSemaphore(NULL, regions->spares.size(), regions->spares.size(), NULL);
+	full_slots = CreateSemaphore(NULL, 0, PIPELINE_DEPTH, NULL);
+}
+
+unsigned char* _Pipeline::take_spare() {
+	WaitForSingleObject(free_spares, INFINITE);
+	EnterCriticalSection(&lock);
+	unsigned char *buffer = regions->spares.back();
+	regions->spares.pop_back();
+	LeaveCriticalSection(&lock);
+	return buffer;
+}
+
+void _Pipeline::give_spare(unsigned char *buffer) {
+	EnterCriticalSection(&lock);
+	regions->spares.push_back(buffer);
+	LeaveCriticalSection(&lock);
+	ReleaseSemaphore(free_spares, 1, NULL);
+}
+
+void _Pipeline::push(Chunk chunk) {
+	// There are never more chunks in flight than spares, so the ring has room
+	EnterCriticalSection(&lock);
+	ring[write_slot] = chunk;
+	write_slot = (write_slot + 1) % PIPELINE_DEPTH;
+	LeaveCriticalSection(&lock);
+	ReleaseSemaphore(full_slots, 1, NULL);
+}
+
+Chunk _Pipeline::pop() {
+	WaitForSingleObject(full_slots, INFINITE);
+	EnterCriticalSection(&lock);
+	Chunk chunk = ring[read_slot];
+	read_slot = (read_slot + 1) % PIPELINE_DEPTH;
+	LeaveCriticalSection(&lock);
+	return chunk;
+}
+
+void _Pipeline::read_all() {
+	while(1) {
+		LONG job = InterlockedIncrement(&next_job) - 1;
+		if(job >= (LONG) jobs.size()) {
+			break;
+		}
+		Chunk chunk = jobs[job];
+		chunk.buffer = take_spare();
+		chunk.ok = regions->read_chunk(chunk.region, chunk.offset, chunk.buffer);
+		push(chunk);
+	}
+}
+
+DWORD WINAPI _Pipeline::reader_proc(LPVOID param) {
+	((_Pipeline*) param)->read_all();
+	return 0;
+}
+
+void _Pipeline::compare(Chunk chunk) {
+	unsigned char *spare = chunk.buffer;
+	if(read_only) {
+		give_spare(spare);
+		return;
+	}
+	if(chunk.ok) {
+		regions->compare_chunk(chunk.region, chunk.offset, chunk.buffer, condition, val, group);
+		spare = regions->keep_chunk(chunk.region, chunk.offset, chunk.buffer);
+	} else {
+		regions->fail_chunk(chunk.region, chunk.offset);
+	}
+	give_spare(spare);
+	regions->finish_chunk(chunk.region, group);
+}
+
+void _Pipeline::compare_all() {
+	// Each claim is one chunk the readers will hand over, so no worker waits for a chunk that never comes
+	while(InterlockedIncrement(&next_compare) - 1 < (LONG) jobs.size()) {
+		compare(pop());
+	}
+}
+
+DWORD WINAPI _Pipeline::compare_proc(LPVOID param) {
+	((_Pipeline*) param)->compare_all();
+	return 0;
+}
+
+void _Pipeline::run(Search_Condition condition, unsigned int val, const Group *group, unsigned int readers, unsigned int workers) {
+	this->condition = condition;
+	this->val = val;
+	this->group = group;
+	if(!free_spares || !full_slots) {
+		// Fall back to reading and comparing each region one chunk after the other
+		for(unsigned int r = 0; r < regions->count(); r++) {
+			if(read_only) {
+				regions->read_region(r);
+			} else {
+				regions->update_region(r, condition, val, group);
+			}
+		}
+		return;
+	}
+	for(unsigned int i = 0; i < jobs.size() && !read_only; i++) {
+		if(jobs[i].offset == 0) {
+			regions->begin_update(jobs[i].region);
+		}
+	}
+
+	vector<HANDLE> threads;
+	for(unsigned int i = 0; i < readers; i++) {
+		HANDLE reader = CreateThread(NULL, 0, reader_proc, this, 0, NULL);
+		if(reader) {
+			threads.push_back(reader);
+		}
+	}
+	if(threads.empty()) {
+		// Fall back to reading and comparing one chunk after the other on this thread
+		for(unsigned int i = 0; i < jobs.size(); i++) {
+			Chunk chunk = jobs[i];
+			chunk.buffer = take_spare();
+			chunk.ok = regions->read_chunk(chunk.region, chunk.offset, chunk.buffer);
+			compare(chunk);
+		}
+		return;
+	}
+
+	// The calling thread is one of the compare workers
+	for(unsigned int i = 1; i < workers; i++) {
+		HANDLE worker = CreateThread(NULL, 0, compare_proc, this, 0, NULL);
+		if(worker) {
+			threads.push_back(worker);
+		}
+	}
+	compare_all();
+	for(unsigned int i = 0; i < threads.size(); i++) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+}
+
+void _Pipeline::read(unsigned int readers) {
+	read_only = true;
+	run(COND_UNCONDITIONAL, 0, NULL, readers, COMPARE_WORKERS);
+}
+
+_Pipeline::~_Pipeline() {
+	DeleteCriticalSection(&lock);
+	if(free_spares) {
+		CloseHandle(free_spares);
+	}
+	if(full_slots) {
+		CloseHandle(full_slots);
+	}
+}
+
+_Result_Writer::_Result_Writer(FILE *out, Output_Format format) {
+	this->out = out;
+	this->format = format;
+	this->buffer.resize(WRITER_BUFFER_SIZE);
+	this->used = 0;
+}
+
+void _Result_Writer::write(const char *data, SIZE_T bytes) {
+	if(this->used + bytes > this->buffer.size()) {
+		flush();
+	}
+	if(bytes > this->buffer.size()) {
+		fwrite(data, 1, bytes, this->out);
+		return;
+	}
+	memcpy(&this->buffer[this->used], data, bytes);
+	this->used += bytes;
+}
+
+void _Result_Writer::write_match(unsigned int index, unsigned char *addr, unsigned int val) {
+	char line[128];
+	int length = 0;
+	unsigned long long address = (unsigned long long) (SIZE_T) addr;
+	switch(this->format) {
+		case OUTPUT_TEXT:
+			length = sprintf(line, "%u: Address - 0x%08llx: Value - (Hex) 0x%08x, (Dec) %u\r\n", index, address, val, val);
+			break;
+		case OUTPUT_CSV:
+			length = sprintf(line, "%u,0x%llx,%u\n", index, address, val);
+			break;
+		case OUTPUT_JSONL:
+			length = sprintf(line, "{\"index\":%u,\"address\":\"0x%llx\",\"value\":%u}\n", index, address, val);
+			break;
+		case OUTPUT_BINARY:
+			for(int i = 0; i < 8; i++) {
+				line[length++] = (char) (address >> (8 * i));
+			}
+			for(int i = 0; i < 4; i++) {
+				line[length++] = (char) (val >> (8 * i));
+			}
+			break;
+	}
+	write(line, length);
+}
+
+void _Result_Writer::flush() {
+	if(this->used > 0) {
+		fwrite(&this->buffer[0], 1, this->used, this->out);
+		this->used = 0;
+	}
+	fflush(this->out);
+}
+
+_Result_Writer::~_Result_Writer() {
+	flush();
+}
+
+_Scan::_Scan() {
+	regions = new Region_Table();
+	engine = ENGINE_QUEUED;
+	filtered = false;
+}
+
+_Scan::_Scan(unsigned int pid, int data_size) {
+	regions = new Region_Table();
+	engine = ENGINE_QUEUED;
+	filtered = false;
+	open(pid, data_size);
+}
+
+bool _Scan::open(unsigned int pid, int data_size) {
+	vector<MEMORY_BASIC_INFORMATION> found;
+	MEMORY_BASIC_INFORMATION meminfo;
+	unsigned char *addr = 0;
+
+	// Gets the handle of the process with a request for all access
+	HANDLE hProc = OpenProcess(PROCESS_ALL_ACCESS, false, pid);
+
+	if(!hProc) {
+		return false;
+	}
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	while(addr < si.lpMaximumApplicationAddress) {
+		// Retrievs the BASIC_MEMORY_INFORMATION object of the process of interest
+		if(VirtualQueryEx(hProc, addr, &meminfo, sizeof(meminfo)) == 0) {
+			break;
+		}
+		// Check for flags to ensure it isn't empty reserved memory and it has write permissions
+		if((meminfo.State & MEM_COMMIT) && (meminfo.Protect & WRITABLE)) {
+			found.push_back(meminfo);
+		}
+		addr = (unsigned char*) meminfo.BaseAddress + meminfo.RegionSize;
+	}
+	if(found.empty()) {
+		CloseHandle(hProc);
+		return false;
+	}
+	if(!open(hProc, found, data_size)) {
+		CloseHandle(hProc);
+		return false;
+	}
+	return regions->count() > 0;
+}
+
+bool _Scan::open(HANDLE hProc, const vector<MEMORY_BASIC_INFORMATION> &regions, int data_size) {
+	if(!this->regions->reset(hProc, regions, data_size)) {
+		return false;
+	}
+	filtered = false;
+	return true;
+}
+
+bool _Scan::update(Search_Condition condition, unsigned int val, const Group *group) {
+	// Group post-processing keys on the group, so only hand it down for a group search
+	if(condition != COND_GROUP) {
+		group = NULL;
+	} else if(!group) {
+		return false;
+	}
+
+	// If the condition is unconditional, the searhmask is updated with a match for each piece of data in the buffer
+	if(condition == COND_UNCONDITIONAL) {
+		for(unsigned int r = 0; r < regions->count(); r++) {
+			regions->reset_region(r);
+		}
+	} else if(engine == ENGINE_SYNC) {
+		for(unsigned int r = 0; r < regions->count(); r++) {
+			regions->update_region(r, condition, val, group);
+		}
+	} else {
+		Pipeline pipeline(regions);
+		pipeline.run(condition, val, group, (engine == ENGINE_QUEUED) ? QUEUE_DEPTH : 1, COMPARE_WORKERS);
+	}
+	filtered = (condition != COND_UNCONDITIONAL);
+	return true;
+}
+
+void _Scan::read_regions() {
+	if(engine == ENGINE_SYNC) {
+		for(unsigned int r = 0; r < regions->count(); r++) {
+			regions->read_region(r);
+		}
+	} else {
+		Pipeline pipeline(regions);
+		pipeline.read((engine == ENGINE_QUEUED) ? QUEUE_DEPTH : 1);
+	}
+}
+
+bool _Scan::poke(unsigned char *addr, unsigned int val) {
+	return WriteProcessMemory(regions->hProc, addr, &val, regions->data_size, NULL) != 0;
+}
+
+bool _Scan::peek(unsigned char *addr, unsigned int &val) {
+	val = 0;
+	return read_memory(regions->hProc, addr, &val, regions->data_size);
+}
+
+void _Scan::scan_dump() {
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		printf("%p %lu\r\n", (void*) regions->base[r], (unsigned long) regions->size[r]);
+	}
+}
+
+unsigned int _Scan::write_matches(Result_Writer &writer, unsigned int first, unsigned int max, bool live, unsigned int *failed) {
+	unsigned int index = 0;
+	unsigned int written = 0;
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		// Skip whole regions before the first match wanted using their match counts
+		if(index + regions->matches[r] <= first) {
+			index += regions->matches[r];
+			continue;
+		}
+		for(SIZE_T offset = 0; offset < regions->size[r]; offset += regions->data_size) {
+			if(!regions->is_in_search(r, offset)) {
+				continue;
+			}
+			if(index >= first) {
+				unsigned int val = 0;
+				if(!live) {
+					memcpy(&val, regions->snapshot_at(r, offset), regions->data_size);
+				} else if(!peek(regions->base[r] + offset, val)) {
+					if(failed) {
+						(*failed)++;
+					}
+					index++;
+					continue;
+				}
+				writer.write_match(index, regions->base[r] + offset, val);
+				if(++written == max) {
+					return written;
+				}
+			}
+			index++;
+		}
+	}
+	return written;
+}
+
+unsigned int _Scan::print_matches() {
+	unsigned int failed = 0;
+	Result_Writer writer(stdout, OUTPUT_TEXT);
+	write_matches(writer, 0, 0, true, &failed);
+	return failed;
+}
+
+unsigned int _Scan::get_matches() {
+	unsigned int count = 0;
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		count += count_mask(regions->mask_of(r), regions->size[r]);
+	}
+	return count;
+}
+
+unsigned int _Scan::get_matches2() {
+	unsigned int count = 0;
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		count += regions->matches[r];
+	}
+	return count;
+}
+
+unsigned char* _Scan::get_match(unsigned int index) {
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		// Skip whole regions using their match counts
+		if(index >= regions->matches[r]) {
+			index -= regions->matches[r];
+			continue;
+		}
+		for(SIZE_T offset = 0; offset < regions->size[r]; offset += regions->data_size) {
+			if(regions->is_in_search(r, offset) && index-- == 0) {
+				return regions->base[r] + offset;
+			}
+		}
+	}
+	return NULL;
+}
+
+unsigned int _Scan::get_size() {
+	unsigned int size = 0;
+	for(unsigned int r = 0; r < regions->count(); r++) {
+		size += regions->size[r];
+	}
+	return size;
+}
+
+int _Scan::get_blocks() {
+	return regions->count();
+}
+
+int _Scan::get_data_size() {
+	return regions->data_size;
+}
+
+unsigned int _Scan::get_dropped() {
+	return regions->dropped;
+}
+
+bool _Scan::use_large_pages(bool large_pages) {
+	return regions->use_large_pages(large_pages);
+}
+
+void _Scan::set_engine(Read_Engine engine) {
+	this->engine = engine;
+}
+
+Read_Engine _Scan::get_engine() {
+	return engine;
+}
+
+bool _Scan::is_filtered() {
+	return filtered;
+}
+
+bool _Scan::is_alive() {
+	DWORD exit_code;
+	if(!regions->hProc || !GetExitCodeProcess(regions->hProc, &exit_code)) {
+		return false;
+	}
+	return exit_code == STILL_ACTIVE;
+}
+
+_Scan::~_Scan() {
+	delete regions;
+}
+
+// Leading fields of each record NtQuerySystemInformation returns for SystemProcessInformation.
+// winternl.h keeps the creation time in a reserved block, so the layout is spelled out here.
+typedef struct _Native_Process {
+	ULONG next_entry_offset;
+	ULONG thread_count;
+	LARGE_INTEGER reserved[3];
+	LARGE_INTEGER create_time;
+	LARGE_INTEGER user_time;
+	LARGE_INTEGER kernel_time;
+	USHORT name_length;
+	USHORT name_max_length;
+	WCHAR *name;
+	LONG base_priority;
+	HANDLE pid;
+	HANDLE parent_pid;
+	ULONG handle_count;
+	ULONG session_id;
+	ULONG_PTR process_key;
+	SIZE_T peak_virtual_size;
+	SIZE_T virtual_size;
+	ULONG page_fault_count;
+	SIZE_T peak_working_set_size;
+	SIZE_T working_set_size;
+} Native_Process;
+
+typedef LONG (WINAPI *Query_System_Information)(ULONG info_class, PVOID info, ULONG info_size, PULONG needed);
+
+#define SYSTEM_PROCESS_INFORMATION_CLASS 5
+#define STATUS_INFO_LENGTH_MISMATCH ((LONG) 0xC0000004)
+
+_Process_Catalog::_Process_Catalog() {
+	generation = 0;
+}
+
+void _Process_Catalog::query(Process_Entry &entry) {
+	HANDLE hProc = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, false, entry.pid);
+	if(!hProc) {
+		return;
+	}
+	char path[MAX_PATH];
+	DWORD path_size = sizeof(path);
+	if(QueryFullProcessImageName(hProc, 0, path, &path_size)) {
+		entry.path = string(path, path_size);
+	}
+	CloseHandle(hProc);
+}
+
+bool _Process_Catalog::refresh() {
+	// ntdll is in every process, but NtQuerySystemInformation isn't in the import libraries
+	static Query_System_Information query_system = (Query_System_Information)
+		GetProcAddress(GetModuleHandle("ntdll.dll"), "NtQuerySystemInformation");
+	if(!query_system) {
+		return false;
+	}
+
+	// The list can grow between asking for its size and reading it, so leave some room
+	ULONG needed = 0;
+	LONG status;
+	if(buffer.empty()) {
+		buffer.resize(256 * 1024);
+	}
+	while((status = query_system(SYSTEM_PROCESS_INFORMATION_CLASS, &buffer[0], (ULONG) buffer.size(), &needed))
+		== STATUS_INFO_LENGTH_MISMATCH) {
+		buffer.resize(needed + 64 * 1024);
+	}
+	if(status < 0) {
+		return false;
+	}
+
+	generation++;
+	for(SIZE_T pos = 0; ; ) {
+		const Native_Process *info = (const Native_Process*) &buffer[pos];
+		DWORD pid = (DWORD) (ULONG_PTR) info->pid;
+		ULONGLONG created = (ULONGLONG) info->create_time.QuadPart;
+		map<DWORD, Process_Entry>::iterator it = processes.find(pid);
+		if(it != processes.end() && it->second.created != created) {
+			// The PID has been reused by another process
+			processes.erase(it);
+			it = processes.end();
+		}
+		if(it == processes.end()) {
+			Process_Entry entry;
+			entry.pid = pid;
+			char name[MAX_PATH];
+			int name_size = WideCharToMultiByte(CP_ACP, 0, info->name, info->name_length / sizeof(WCHAR),
+				name, sizeof(name), NULL, NULL);
+			entry.name = (name_size > 0) ? string(name, name_size) : "[System Process]";
+			entry.created = created;
+			query(entry);
+			it = processes.insert(make_pair(entry.pid, entry)).first;
+		}
+		it->second.working_set = info->working_set_size;
+		it->second.generation = generation;
+		if(info->next_entry_offset == 0) {
+			break;
+		}
+		pos += info->next_entry_offset;
+	}
+
+	// Forget the processes that have exited
+	for(map<DWORD, Process_Entry>::iterator it = processes.begin(); it != processes.end();) {
+		if(it->second.generation != generation) {
+			processes.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	return true;
+}
+
+string _Process_Catalog::lower(string text) {
+	for(unsigned int i = 0; i < text.size(); i++) {
+		text[i] = tolower((unsigned char) text[i]);
+	}
+	return text;
+}
+
+const Process_Entry* _Process_Catalog::find_by_name(const string &name) {
+	const Process_Entry *found = NULL;
+	string lower_name = lower(name);
+	for(map<DWORD, Process_Entry>::iterator it = processes.begin(); it != processes.end(); ++it) {
+		if(lower(it->second.name) == lower_name && (!found || it->second.created > found->created)) {
+			found = &it->second;
+		}
+	}
+	return found;
+}
+
+const Process_Entry* _Process_Catalog::find(const string &pattern) {
+	const Process_Entry *found = find_by_name(pattern);
+	if(found) {
+		return found;
+	}
+
+	regex re;
+	try {
+		re = regex(pattern, regex::icase);
+	} catch(const regex_error&) {
+		return NULL;
+	}
+	for(map<DWORD, Process_Entry>::iterator it = processes.begin(); it != processes.end(); ++it) {
+		if((regex_search(it->second.name, re) || regex_search(it->second.path, re))
+			&& (!found || it->second.created > found->created)) {
+			found = &it->second;
+		}
+	}
+	return found;
+}
+
+const Process_Entry* _Process_Catalog::find(DWORD pid) {
+	map<DWORD, Process_Entry>::iterator it = processes.find(pid);
+	return (it != processes.end()) ? &it->second : NULL;
+}
+
+void _Process_Catalog::print() {
+	for(map<DWORD, Process_Entry>::iterator it = processes.begin(); it != processes.end(); ++it) {
+		printf("%-30s %-10lu %10lu K %s\r\n", it->second.name.c_str(), (unsigned long) it->second.pid,
+			(unsigned long) (it->second.working_set / 1024), it->second.path.c_str());
+	}
+}